@@ -6,7 +6,30 @@
 #include <chrono>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 #include <random>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <charconv>
+#include <string_view>
+#include <unistd.h>
+#ifdef OTHELLO_PROFILE
+#include <atomic>
+#include <fstream>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define OTHELLO_AVX2
+#endif
 
 enum class Command;
 enum class Square;
@@ -21,15 +44,53 @@ const char ASCII_A = 65;
 const uint8_t LINE_LENGTH = 8;
 const uint8_t NUM_SQUARES = 64;
 const uint8_t MAX_DEPTH = 5;
+const uint8_t BENCH_DEPTH = 4;
+const uint8_t OPENING_EMPTIES = 50;
+const uint8_t MIDGAME_EMPTIES = 12; // fewest empties still counted as midgame
+const uint8_t MOVES_TO_GO_RESERVE = 4;
+const int OPENING_SHARE = 50; // percent of an even share of the game clock per game phase
+const int MIDGAME_SHARE = 150;
+const int HARD_SHARES = 2; // hard limit, in even shares of the game clock
+const int DEFAULT_GROWTH = 6; // next iteration time over the last, until two iterations were timed
+const int MIN_GROWTH = 2;
+const int MAX_GROWTH = 16;
+const int MIN_SAFETY_MARGIN_MS = 100;
+const int OVERSHOOT_MARGIN_FACTOR = 4;
+const int MIN_THINK_MS = 10;
 const std::array<coord, 4> CORNERS = {coord{0, 0}, coord{0, 7}, coord{7, 0}, coord{7, 7}};
+const uint8_t BENCH_EVAL_ROUNDS = 20;
+const uint16_t BENCH_KERNEL_ROUNDS = 500;
+const uint8_t EVAL_BATCH = 4; // positions per kernel call, the AVX2 lane count
+const uint8_t INVALID_SQUARE = 0x80;
+const size_t READ_BUFFER_SIZE = 1 << 16;
+const char WHITESPACE[] = " \t\v\f\r"; // what operator>> skips, lines never contain '\n'
+#ifdef OTHELLO_PROFILE
+const std::array<const char *, 4> PROFILE_METRICS = {"cycles", "instructions", "cache_misses", "branch_misses"};
+#endif
+const uint64_t COL_A = 0x0101010101010101ULL;
+const uint64_t COL_H = 0x8080808080808080ULL;
+const uint64_t CORNER_MASK = 0x8100000000000081ULL;
+const std::array<uint64_t, 4> CORNER_BITS = {0x1ULL, 0x80ULL, 0x100000000000000ULL, 0x8000000000000000ULL};
+const std::array<uint64_t, 4> CORNER_NEIGHBOURS = {0x302ULL, 0xC040ULL, 0x203000000000000ULL, 0x40C0000000000000ULL};
+const std::array<coord, 8> DIRECTIONS = {coord{-1, -1}, coord{-1, 0}, coord{-1, 1}, coord{0, -1},
+                                         coord{0, 1}, coord{1, -1}, coord{1, 0}, coord{1, 1}};
 std::mutex mutex;
+std::condition_variable search_done;
 
 enum class Command
 {
     start,
     stop,
     move,
-    play
+    play,
+    bench
+};
+
+enum class Limit
+{
+    time,
+    nodes,
+    depth
 };
 
 enum class Square
@@ -82,6 +143,49 @@ struct Game
     }
 };
 
+struct Bitboards
+{
+
+    uint64_t mine = 0; // discs of game.my_colour, bit i * 8 + j is board[i][j]
+    uint64_t theirs = 0;
+};
+
+struct EvalTerms
+{
+
+    int my_coins = 0;
+    int op_coins = 0;
+    int my_mobility = 0; // counted per flanking direction, like get_moves
+    int op_mobility = 0;
+    int my_corners = 0;
+    int op_corners = 0;
+};
+
+typedef void (*EvalKernel)(const Bitboards *boards, size_t count, EvalTerms *terms);
+
+struct Clock
+{
+
+    bool game_clock = false; // false: Game::time seconds per move, true: remaining + increment per move
+    std::chrono::milliseconds remaining{0};
+    std::chrono::milliseconds increment{0};
+    std::chrono::microseconds overshoot{0}; // worst observed lateness of a reply past its hard limit
+};
+
+struct Search
+{
+
+    bool time_up = false;
+    bool done = false;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::milliseconds soft{0}; // stop deepening past this, extended when the best move changes
+    std::chrono::milliseconds hard{0}; // answer no later than this
+    Limit limit = Limit::time;
+    uint8_t depth = MAX_DEPTH;
+    uint64_t nodes = 0;
+    uint64_t max_nodes = 0;
+};
+
 struct Move
 {
 
@@ -110,117 +214,477 @@ struct Move
     }
 };
 
-Command get_command(std::string line)
+struct LineReader
 {
 
-    std::string command;
-    std::stringstream ss(line);
-    ss >> command;
+    std::vector<char> buffer;
+    size_t begin = 0;
+    size_t end = 0;
+    bool eof = false;
+
+    LineReader() : buffer(READ_BUFFER_SIZE) {}
 
-    if (command.compare("START") == 0)
+    bool next_line(std::string_view &line)
     {
-        return Command::start;
+        while (true)
+        {
+            const char *first = buffer.data() + begin;
+            const char *newline = static_cast<const char *>(std::memchr(first, '\n', end - begin));
+            if (newline != nullptr || (eof && begin < end))
+            {
+                size_t length = newline != nullptr ? newline - first : end - begin;
+                begin += newline != nullptr ? length + 1 : length;
+                line = std::string_view(first, length);
+                if (!line.empty() && line.back() == '\r')
+                    line.remove_suffix(1);
+                return true;
+            }
+            if (eof)
+                return false;
+            fill();
+        }
     }
-    if (command.compare("MOVE") == 0)
-    {
-        return Command::move;
+
+    void fill()
+    { // keep the unfinished line, then read whatever input is available
+        if (begin > 0)
+        {
+            std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+            end -= begin;
+            begin = 0;
+        }
+        if (end == buffer.size())
+            buffer.resize(buffer.size() * 2);
+
+        ssize_t received;
+        do
+        {
+            received = ::read(STDIN_FILENO, buffer.data() + end, buffer.size() - end);
+        } while (received < 0 && errno == EINTR);
+
+        if (received <= 0)
+            eof = true;
+        else
+            end += received;
     }
-    if (command.compare("STOP") == 0)
+};
+
+constexpr std::array<uint8_t, 256> make_square_codes()
+{
+    std::array<uint8_t, 256> codes{};
+    for (auto &code : codes)
+        code = INVALID_SQUARE;
+    codes['-'] = static_cast<uint8_t>(Square::empty);
+    codes['X'] = static_cast<uint8_t>(Square::black);
+    codes['O'] = static_cast<uint8_t>(Square::white);
+    return codes;
+}
+
+constexpr std::array<uint8_t, 256> SQUARE_CODES = make_square_codes();
+
+std::string_view next_token(std::string_view &line)
+{
+    size_t first = line.find_first_not_of(WHITESPACE);
+    if (first == std::string_view::npos)
     {
-        return Command::stop;
+        line = std::string_view();
+        return line;
     }
-    if (command.compare("PLAY") == 0)
+    line.remove_prefix(first);
+    size_t length = std::min(line.find_first_of(WHITESPACE), line.size());
+    std::string_view token = line.substr(0, length);
+    line.remove_prefix(length);
+    return token;
+}
+
+bool parse_number(std::string_view token, long long &value)
+{
+    auto result = std::from_chars(token.data(), token.data() + token.size(), value);
+    return !token.empty() && result.ec == std::errc() && result.ptr == token.data() + token.size();
+}
+
+bool get_command(std::string_view line, Command &command)
+{
+
+    std::string_view name = next_token(line);
+
+    if (name == "START")
+        command = Command::start;
+    else if (name == "MOVE")
+        command = Command::move;
+    else if (name == "STOP")
+        command = Command::stop;
+    else if (name == "PLAY")
+        command = Command::play;
+    else if (name == "BENCH")
+        command = Command::bench;
+    else
     {
-        return Command::play;
+        std::clog << "Invalid command" << std::endl;
+        return false;
     }
 
-    std::clog << "Invalid command";
-    exit(1);
+    return true;
 }
 
-Game get_params(const std::string &input)
+bool get_params(std::string_view input, Game &game, Clock &clock)
 {
 
-    Game game = Game();
-    std::stringstream ss(input);
-    std::string colour;
-    std::string time_str;
-    int time;
+    Game params = Game();
+    Clock params_clock;
+    long long time = 0;
+    long long increment = 0;
 
-    ss >> colour;
-    ss >> colour;
-    ss >> time;
+    next_token(input);
+    std::string_view colour = next_token(input);
 
-    if (colour.compare("W") == 0 || colour.compare("B") == 0)
+    if (colour == "W" || colour == "B")
     {
-        colour.compare("W") == 0 ? game.my_colour = Square::white : game.my_colour = Square::black;
+        colour == "W" ? params.my_colour = Square::white : params.my_colour = Square::black;
     }
     else
     {
-        std::clog << "Invalid Colour paramter";
-        exit(1);
+        std::clog << "Invalid Colour paramter" << std::endl;
+        return false;
     }
 
-    if (time < 1)
+    if (!parse_number(next_token(input), time) || time < 1 || time > std::numeric_limits<int>::max() / 1000)
     {
-        std::clog << "Invalid time paramter";
-        exit(1);
+        std::clog << "Invalid time paramter" << std::endl;
+        return false;
+    }
+
+    std::string_view option = next_token(input);
+    if (!option.empty())
+    {
+        if (option != "INC" || !parse_number(next_token(input), increment) || increment < 0 ||
+            increment > std::numeric_limits<int>::max() / 1000 || !next_token(input).empty())
+        {
+            std::clog << "Invalid increment paramter" << std::endl;
+            return false;
+        }
+        params_clock.game_clock = true;
+        params_clock.remaining = std::chrono::seconds(time);
+        params_clock.increment = std::chrono::seconds(increment);
     }
 
-    game.time = time;
-    game.started = true;
+    params.time = static_cast<int>(time);
+    params.started = true;
+    params_clock.overshoot = clock.overshoot;
+    game = params;
+    clock = params_clock;
 
-    return game;
+    return true;
 }
 
-void get_state(const std::string &input, Game &game)
+bool load_board(std::string_view state, Game &game)
 {
+    if (state.size() != NUM_SQUARES)
+    {
+        std::clog << "Invalid game state on input." << std::endl;
+        return false;
+    }
 
-    std::stringstream ss(input);
-    std::string state;
+    short black = 0;
+    short white = 0;
+    uint8_t invalid = 0;
+
+    for (uint8_t i = 0; i < NUM_SQUARES; i++)
+    { // on failure the board is left half written, callers pass a per-command copy
+        uint8_t code = SQUARE_CODES[static_cast<unsigned char>(state[i])];
+        invalid |= code;
+        black += code == static_cast<uint8_t>(Square::black);
+        white += code == static_cast<uint8_t>(Square::white);
+        game.board[i / LINE_LENGTH][i % LINE_LENGTH] = static_cast<Square>(code & ~INVALID_SQUARE);
+    }
 
-    ss >> state;
-    ss >> state;
+    if (invalid & INVALID_SQUARE)
+    {
+        std::clog << "Invalid game state on input." << std::endl;
+        return false;
+    }
+
+    game.black_squares = black;
+    game.white_squares = white;
+
+    return true;
+}
+
+bool get_state(std::string_view input, Game &game)
+{
+
+    next_token(input);
 
     if (game.started == false)
     {
-        std::clog << "MOVE called before START.";
-        exit(1);
+        std::clog << "MOVE called before START." << std::endl;
+        return false;
     }
-    if (state.size() > NUM_SQUARES)
+
+    return load_board(next_token(input), game);
+}
+
+bool get_limits(std::string_view input, Search &search)
+{
+
+    long long value = 0;
+
+    next_token(input);
+    next_token(input);
+    std::string_view limit = next_token(input);
+
+    if (limit.empty())
     {
-        std::clog << "Invalid game state on input.";
-        exit(1);
+        return true; // plain MOVE, searched against the clock
+    }
+    if (!parse_number(next_token(input), value) || value < 1 || !next_token(input).empty())
+    {
+        std::clog << "Invalid search limit." << std::endl;
+        return false;
     }
 
-    game.black_squares = 0;
-    game.white_squares = 0;
+    if (limit == "NODES")
+    {
+        search.limit = Limit::nodes;
+        search.max_nodes = static_cast<uint64_t>(value);
+        search.depth = NUM_SQUARES; // deepen until the budget runs out
+    }
+    else if (limit == "DEPTH" && value <= std::numeric_limits<uint8_t>::max())
+    {
+        search.limit = Limit::depth;
+        search.depth = static_cast<uint8_t>(value);
+    }
+    else
+    {
+        std::clog << "Invalid search limit." << std::endl;
+        return false;
+    }
 
-    for (uint8_t i = 0; i < NUM_SQUARES; i++)
+    return true;
+}
+
+#ifdef OTHELLO_PROFILE
+// Built with -DOTHELLO_PROFILE: every PROFILE_SCOPE records calls, cycles and hardware counters
+// per call path, and each search appends its totals (and call counts) to othello_profile.<metric>.folded files
+// that flamegraph.pl reads directly.
+struct ProfileNode
+{
+
+    const char *name;
+    size_t parent;
+    std::vector<size_t> children;
+    uint64_t calls = 0;
+    std::array<uint64_t, PROFILE_METRICS.size()> inclusive{};
+};
+
+struct Profiler
+{
+
+    std::vector<ProfileNode> nodes;
+    size_t current = 0;
+    inline static std::atomic<uint64_t> searches{0}; // shared, each search may run on a new thread
+    inline static std::atomic<bool> warned{false};
+    std::array<int, PROFILE_METRICS.size() - 1> fds = {-1, -1, -1}; // fds[0] leads the group
+    std::array<perf_event_mmap_page *, PROFILE_METRICS.size() - 1> pages{};
+
+    Profiler()
     {
+        nodes.push_back(ProfileNode{"search", 0, {}});
 
-        Square square;
-        if (state[i] == '-')
-            square = Square::empty;
-        else if (state[i] == 'X')
+        std::array<uint64_t, 3> configs = {PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+        for (uint8_t i = 0; i < configs.size(); i++)
         {
-            game.black_squares++;
-            square = Square::black;
+            perf_event_attr attr{};
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[i];
+            attr.disabled = i == 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP;
+            int fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, fds[0], 0));
+            if (fd < 0)
+            {
+                if (!warned.exchange(true))
+                    std::clog << "perf_event_open failed, hardware counters will read 0." << std::endl;
+                close_counters();
+                return;
+            }
+            fds[i] = fd;
+            void *page = mmap(nullptr, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, fd, 0);
+            pages[i] = page != MAP_FAILED ? static_cast<perf_event_mmap_page *>(page) : nullptr;
         }
-        else if (state[i] == 'O')
+
+        ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+
+    ~Profiler()
+    {
+        close_counters();
+    }
+
+    void close_counters()
+    {
+        for (uint8_t i = fds.size(); i-- > 0;)
+        { // members before the leader
+            if (pages[i] != nullptr)
+                munmap(pages[i], sysconf(_SC_PAGESIZE));
+            if (fds[i] >= 0)
+                close(fds[i]);
+            pages[i] = nullptr;
+            fds[i] = -1;
+        }
+    }
+
+    bool read_user(uint8_t counter, uint64_t &value)
+    { // rdpmc through the mmap'd page, no syscall; false when the kernel doesn't allow it
+#if defined(__x86_64__) || defined(__i386__)
+        volatile perf_event_mmap_page *page = pages[counter];
+        if (page == nullptr)
+            return false;
+        uint32_t sequence;
+        do
         {
-            game.white_squares++;
-            square = Square::white;
+            sequence = page->lock;
+            std::atomic_signal_fence(std::memory_order_acquire);
+            uint32_t index = page->index;
+            if (!page->cap_user_rdpmc || index == 0)
+                return false;
+            uint16_t width = page->pmc_width;
+            int64_t count = static_cast<int64_t>(static_cast<uint64_t>(__rdpmc(index - 1)) << (64 - width)) >> (64 - width);
+            value = page->offset + count;
+            std::atomic_signal_fence(std::memory_order_acquire);
+        } while (page->lock != sequence);
+        return true;
+#else
+        (void)counter;
+        (void)value;
+        return false;
+#endif
+    }
+
+    void sample(std::array<uint64_t, PROFILE_METRICS.size()> &values)
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        values[0] = __rdtsc();
+#else
+        values[0] = std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+        if (fds[0] < 0)
+        {
+            std::fill(values.begin() + 1, values.end(), 0);
+            return;
         }
-        else
+        bool user = true;
+        for (uint8_t i = 0; i < fds.size() && user; i++)
+        {
+            user = read_user(i, values[i + 1]);
+        }
+        std::array<uint64_t, PROFILE_METRICS.size()> group{}; // {nr, instructions, cache misses, branch misses}
+        if (!user && ::read(fds[0], group.data(), sizeof(group)) == sizeof(group))
         {
-            std::clog << "Invalid game state on input.";
-            exit(1);
+            std::copy(group.begin() + 1, group.end(), values.begin() + 1);
         }
+    }
 
-        game.board[i / LINE_LENGTH][i % LINE_LENGTH] = square;
+    size_t enter(const char *name)
+    {
+        for (size_t child : nodes[current].children)
+        {
+            if (nodes[child].name == name)
+                return current = child;
+        }
+        nodes.push_back(ProfileNode{name, current, {}});
+        nodes[current].children.push_back(nodes.size() - 1);
+        return current = nodes.size() - 1;
     }
-}
+
+    void reset()
+    {
+        nodes.resize(1);
+        nodes[0].children.clear();
+        current = 0;
+    }
+
+    std::string path(size_t node, uint64_t search)
+    {
+        return node == 0 ? "search_" + std::to_string(search) : path(nodes[node].parent, search) + ";" + nodes[node].name;
+    }
+
+    void dump()
+    {
+        uint64_t search = ++searches;
+        for (uint8_t metric = 0; metric < PROFILE_METRICS.size(); metric++)
+        {
+            std::ofstream report(std::string("othello_profile.") + PROFILE_METRICS[metric] + ".folded",
+                                 search == 1 ? std::ios::trunc : std::ios::app);
+            for (size_t node = 1; node < nodes.size(); node++)
+            {
+                uint64_t self = nodes[node].inclusive[metric];
+                for (size_t child : nodes[node].children)
+                {
+                    self -= std::min(self, nodes[child].inclusive[metric]);
+                }
+                report << path(node, search) << " " << self << "\n";
+            }
+        }
+
+        std::ofstream calls("othello_profile.calls.folded", search == 1 ? std::ios::trunc : std::ios::app);
+        for (size_t node = 1; node < nodes.size(); node++)
+        {
+            calls << path(node, search) << " " << nodes[node].calls << "\n";
+        }
+    }
+};
+
+thread_local Profiler profiler;
+
+struct ProfileScope
+{
+
+    size_t node;
+    std::array<uint64_t, PROFILE_METRICS.size()> start;
+
+    ProfileScope(const char *name)
+    {
+        node = profiler.enter(name);
+        profiler.sample(start);
+    }
+
+    ~ProfileScope()
+    {
+        std::array<uint64_t, PROFILE_METRICS.size()> end;
+        profiler.sample(end);
+        for (uint8_t metric = 0; metric < PROFILE_METRICS.size(); metric++)
+        {
+            profiler.nodes[node].inclusive[metric] += end[metric] - start[metric];
+        }
+        profiler.nodes[node].calls++;
+        profiler.current = profiler.nodes[node].parent;
+    }
+};
+
+struct ProfiledSearch
+{
+
+    ProfiledSearch()
+    {
+        profiler.reset();
+    }
+
+    ~ProfiledSearch()
+    {
+        profiler.dump();
+    }
+};
+
+#define PROFILE_SEARCH() ProfiledSearch profiled_search
+#define PROFILE_SCOPE(name) ProfileScope profile_scope(name)
+#else
+#define PROFILE_SEARCH()
+#define PROFILE_SCOPE(name)
+#endif
 
 bool exists(coord pos)
 {
@@ -297,6 +761,7 @@ void flip(Game &game, coord position, int8_t change_row, int8_t change_col, uint
 
 Game perform_move(const Game &game, Move move, Square colour)
 {
+    PROFILE_SCOPE("perform_move");
     Game next_state{game};
 
     next_state.board[move.coords.first][move.coords.second] = colour;
@@ -334,6 +799,7 @@ Game perform_move(const Game &game, Move move, Square colour)
 
 std::vector<Move> get_moves(const Game &game, Square colour)
 {
+    PROFILE_SCOPE("get_moves");
     std::vector<Move> moves;
 
     for (uint8_t i = 0; i < LINE_LENGTH; i++)
@@ -485,9 +951,9 @@ int stability_for_colour(const Game &game, Square colour)
     int8_t my_stability = 0;
     std::array<std::array<Stability, LINE_LENGTH>, LINE_LENGTH> stability_board;
 
-    for (uint8_t i = 1; i < LINE_LENGTH; i++)
+    for (uint8_t i = 0; i < LINE_LENGTH; i++)
     {
-        for (uint8_t j = 1; j < LINE_LENGTH; j++)
+        for (uint8_t j = 0; j < LINE_LENGTH; j++)
         {
             stability_board[i][j] = Stability::unassigned;
         }
@@ -601,6 +1067,7 @@ double mobility_score(const Game &game, const std::vector<Move> &my_moves)
 
 double evaluate_state(const Game &current_state, const std::vector<Move> &moves)
 {
+    PROFILE_SCOPE("evaluate_state");
     double score = 0;
 
     score += 20 * coin_score(current_state);
@@ -611,13 +1078,264 @@ double evaluate_state(const Game &current_state, const std::vector<Move> &moves)
     return score;
 }
 
-double minmax(const Game &current_state, bool &time_up, uint8_t depth, double alpha, double beta, Square colour)
+Bitboards to_bitboards(const Game &game)
+{
+    Bitboards boards;
+
+    for (uint8_t i = 0; i < NUM_SQUARES; i++)
+    {
+        Square square = game.board[i / LINE_LENGTH][i % LINE_LENGTH];
+        if (square == Square::empty)
+            continue;
+        (square == game.my_colour ? boards.mine : boards.theirs) |= 1ULL << i;
+    }
+
+    return boards;
+}
+
+uint64_t shift(uint64_t bits, coord direction)
+{
+    int delta = direction.first * LINE_LENGTH + direction.second;
+    bits = delta > 0 ? bits << delta : bits >> -delta;
+    if (direction.second == 1)
+        bits &= ~COL_A; // drop squares that wrapped around from the H file
+    if (direction.second == -1)
+        bits &= ~COL_H;
+    return bits;
+}
+
+uint64_t shift_by(uint64_t bits, int delta)
+{
+    return delta > 0 ? bits << delta : bits >> -delta;
+}
+
+uint64_t no_wrap(coord direction)
+{ // squares a run may step onto without crossing the board edge
+    return direction.second == 1 ? ~COL_A : (direction.second == -1 ? ~COL_H : ~0ULL);
+}
+
+uint64_t corner_potential_mask(uint64_t occupied)
+{ // neighbours of the empty corners, the four neighbourhoods don't overlap
+    uint64_t mask = 0;
+    for (uint8_t i = 0; i < CORNER_BITS.size(); i++)
+    {
+        if (!(occupied & CORNER_BITS[i]))
+            mask |= CORNER_NEIGHBOURS[i];
+    }
+    return mask;
+}
+
+int mobility_for(uint64_t player, uint64_t opponent)
+{
+    uint64_t empty = ~(player | opponent);
+    int mobility = 0;
+
+    for (auto direction : DIRECTIONS)
+    { // Kogge-Stone fill of player through opponent runs, one square past the run must be empty
+        int delta = direction.first * LINE_LENGTH + direction.second;
+        uint64_t run = opponent & no_wrap(direction);
+        uint64_t flood = player;
+        flood |= run & shift_by(flood, delta);
+        run &= shift_by(run, delta);
+        flood |= run & shift_by(flood, 2 * delta);
+        run &= shift_by(run, 2 * delta);
+        flood |= run & shift_by(flood, 4 * delta);
+        mobility += __builtin_popcountll(shift(flood & opponent, direction) & empty);
+    }
+
+    return mobility;
+}
+
+void eval_terms_scalar(const Bitboards *boards, size_t count, EvalTerms *terms)
+{
+    for (size_t n = 0; n < count; n++)
+    {
+        uint64_t occupied = boards[n].mine | boards[n].theirs;
+        int empty_corners = 4 - __builtin_popcountll(occupied & CORNER_MASK);
+        int potential = __builtin_popcountll(boards[n].theirs & corner_potential_mask(occupied));
+
+        terms[n].my_coins = __builtin_popcountll(boards[n].mine);
+        terms[n].op_coins = __builtin_popcountll(boards[n].theirs);
+        terms[n].my_mobility = mobility_for(boards[n].mine, boards[n].theirs);
+        terms[n].op_mobility = mobility_for(boards[n].theirs, boards[n].mine);
+        terms[n].my_corners = __builtin_popcountll(boards[n].mine & CORNER_MASK) + potential;
+        terms[n].op_corners = __builtin_popcountll(boards[n].theirs & CORNER_MASK) + 3 * empty_corners - potential;
+    }
+}
+
+#ifdef OTHELLO_AVX2
+__attribute__((target("avx2"))) inline __m256i shift_by_avx2(__m256i bits, int delta)
+{
+    return delta > 0 ? _mm256_slli_epi64(bits, delta) : _mm256_srli_epi64(bits, -delta);
+}
+
+__attribute__((target("avx2"))) inline __m256i popcount_bytes_avx2(__m256i bits)
+{ // per-byte popcount through a nibble lookup, AVX2 has no 64-bit popcount
+    const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low_nibble = _mm256_set1_epi8(0x0f);
+    __m256i low = _mm256_and_si256(bits, low_nibble);
+    __m256i high = _mm256_and_si256(_mm256_srli_epi16(bits, 4), low_nibble);
+    return _mm256_add_epi8(_mm256_shuffle_epi8(lookup, low), _mm256_shuffle_epi8(lookup, high));
+}
+
+__attribute__((target("avx2"))) inline __m256i popcount_avx2(__m256i bits)
+{
+    return _mm256_sad_epu8(popcount_bytes_avx2(bits), _mm256_setzero_si256());
+}
+
+__attribute__((target("avx2"))) inline __m256i mobility_avx2(__m256i player, __m256i opponent)
+{
+    __m256i empty = _mm256_xor_si256(_mm256_or_si256(player, opponent), _mm256_set1_epi64x(-1));
+    __m256i byte_counts = _mm256_setzero_si256(); // at most 8 per byte per direction, so no overflow
+
+    for (auto direction : DIRECTIONS)
+    { // same Kogge-Stone fill as mobility_for
+        int delta = direction.first * LINE_LENGTH + direction.second;
+        __m256i edge = _mm256_set1_epi64x(no_wrap(direction));
+        __m256i run = _mm256_and_si256(opponent, edge);
+        __m256i flood = player;
+        flood = _mm256_or_si256(flood, _mm256_and_si256(run, shift_by_avx2(flood, delta)));
+        run = _mm256_and_si256(run, shift_by_avx2(run, delta));
+        flood = _mm256_or_si256(flood, _mm256_and_si256(run, shift_by_avx2(flood, 2 * delta)));
+        run = _mm256_and_si256(run, shift_by_avx2(run, 2 * delta));
+        flood = _mm256_or_si256(flood, _mm256_and_si256(run, shift_by_avx2(flood, 4 * delta)));
+        __m256i moves = _mm256_and_si256(shift_by_avx2(_mm256_and_si256(flood, opponent), delta), edge);
+        byte_counts = _mm256_add_epi8(byte_counts, popcount_bytes_avx2(_mm256_and_si256(moves, empty)));
+    }
+
+    return _mm256_sad_epu8(byte_counts, _mm256_setzero_si256());
+}
+
+__attribute__((target("avx2"))) void eval_terms_avx2(const Bitboards *boards, size_t count, EvalTerms *terms)
+{
+    static_assert(sizeof(Bitboards) == 2 * sizeof(uint64_t), "boards are loaded as packed pairs");
+    const __m256i corners = _mm256_set1_epi64x(CORNER_MASK);
+    size_t n = 0;
+
+    for (; n + 4 <= count; n += 4)
+    { // two loads of {mine, theirs} pairs, unpacked into lanes ordered n, n + 2, n + 1, n + 3
+        __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(boards + n));
+        __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(boards + n + 2));
+        __m256i mine = _mm256_unpacklo_epi64(low, high);
+        __m256i theirs = _mm256_unpackhi_epi64(low, high);
+        __m256i occupied = _mm256_or_si256(mine, theirs);
+
+        __m256i potential_mask = _mm256_setzero_si256();
+        for (uint8_t i = 0; i < CORNER_BITS.size(); i++)
+        {
+            __m256i corner = _mm256_and_si256(occupied, _mm256_set1_epi64x(CORNER_BITS[i]));
+            __m256i empty = _mm256_cmpeq_epi64(corner, _mm256_setzero_si256());
+            potential_mask = _mm256_or_si256(potential_mask, _mm256_and_si256(empty, _mm256_set1_epi64x(CORNER_NEIGHBOURS[i])));
+        }
+        __m256i potential = popcount_avx2(_mm256_and_si256(theirs, potential_mask));
+        __m256i my_captured = popcount_avx2(_mm256_and_si256(mine, corners));
+        __m256i op_captured = popcount_avx2(_mm256_and_si256(theirs, corners));
+        __m256i empty_corners = _mm256_sub_epi64(_mm256_set1_epi64x(4), _mm256_add_epi64(my_captured, op_captured));
+        __m256i my_corners = _mm256_add_epi64(my_captured, potential);
+        __m256i op_corners = _mm256_sub_epi64(_mm256_add_epi64(op_captured, _mm256_add_epi64(empty_corners, _mm256_add_epi64(empty_corners, empty_corners))), potential);
+
+        // every term fits in 16 bits, so each lane carries its six terms in two words
+        __m256i counts = _mm256_or_si256(
+            _mm256_or_si256(popcount_avx2(mine), _mm256_slli_epi64(popcount_avx2(theirs), 16)),
+            _mm256_or_si256(_mm256_slli_epi64(mobility_avx2(mine, theirs), 32), _mm256_slli_epi64(mobility_avx2(theirs, mine), 48)));
+        __m256i corner_counts = _mm256_or_si256(my_corners, _mm256_slli_epi64(op_corners, 16));
+
+        alignas(32) std::array<uint64_t, 4> packed_counts;
+        alignas(32) std::array<uint64_t, 4> packed_corners;
+        _mm256_store_si256(reinterpret_cast<__m256i *>(packed_counts.data()), counts);
+        _mm256_store_si256(reinterpret_cast<__m256i *>(packed_corners.data()), corner_counts);
+
+        const std::array<uint8_t, 4> lane_position = {0, 2, 1, 3};
+        for (uint8_t lane = 0; lane < 4; lane++)
+        {
+            EvalTerms &t = terms[n + lane_position[lane]];
+            t.my_coins = static_cast<int>(packed_counts[lane] & 0xffff);
+            t.op_coins = static_cast<int>((packed_counts[lane] >> 16) & 0xffff);
+            t.my_mobility = static_cast<int>((packed_counts[lane] >> 32) & 0xffff);
+            t.op_mobility = static_cast<int>(packed_counts[lane] >> 48);
+            t.my_corners = static_cast<int>(packed_corners[lane] & 0xffff);
+            t.op_corners = static_cast<int>(packed_corners[lane] >> 16);
+        }
+    }
+
+    eval_terms_scalar(boards + n, count - n, terms + n);
+}
+#endif
+
+EvalKernel select_eval_kernel(const char *&name)
+{
+#ifdef OTHELLO_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        name = "avx2";
+        return eval_terms_avx2;
+    }
+#endif
+    name = "scalar";
+    return eval_terms_scalar;
+}
+
+const char *eval_kernel_name = nullptr;
+const EvalKernel eval_kernel = select_eval_kernel(eval_kernel_name);
+
+void evaluate_states(const Game *states, const Square *to_move, size_t count, double *scores)
+{ // same result as evaluate_state(state, get_moves(state, to_move)) for every position
+    PROFILE_SCOPE("evaluate_states");
+    std::array<Bitboards, EVAL_BATCH> boards;
+    std::array<EvalTerms, EVAL_BATCH> terms;
+
+    for (size_t first = 0; first < count; first += EVAL_BATCH)
+    {
+        size_t batch = std::min(count - first, static_cast<size_t>(EVAL_BATCH));
+        for (size_t n = 0; n < batch; n++)
+        {
+            boards[n] = to_bitboards(states[first + n]);
+        }
+
+        eval_kernel(boards.data(), batch, terms.data());
+
+        for (size_t n = 0; n < batch; n++)
+        {
+            const Game &state = states[first + n];
+            const EvalTerms &t = terms[n];
+            double my_moves_num = to_move[first + n] == state.my_colour ? t.my_mobility : t.op_mobility;
+            double op_moves_num = t.op_mobility;
+            double score = 0;
+
+            score += 20 * static_cast<double>(100 * (t.my_coins - t.op_coins) / (t.my_coins + t.op_coins));
+            score += 5 * (my_moves_num + op_moves_num != 0 ? 100 * (my_moves_num - op_moves_num) / (my_moves_num + op_moves_num) : 0);
+            score += stability_score(state);
+            score += 40 * static_cast<double>(t.my_corners + t.op_corners == 0 ? 0 : 100 * t.my_corners / (t.my_corners + t.op_corners));
+
+            scores[first + n] = score;
+        }
+    }
+}
+
+bool enter_node(Search &search)
 {
     std::unique_lock<std::mutex> guard(mutex);
-    if (time_up)
-        return -1;
+    if (search.time_up)
+        return false;
     guard.unlock();
 
+    if (search.limit == Limit::nodes && search.nodes >= search.max_nodes)
+    {
+        search.time_up = true; // only the search thread runs in this mode
+        return false;
+    }
+    search.nodes++;
+    return true;
+}
+
+double minmax(const Game &current_state, Search &search, uint8_t depth, double alpha, double beta, Square colour)
+{
+    PROFILE_SCOPE("minmax");
+    if (!enter_node(search))
+        return -1;
+
     auto moves = get_moves(current_state, colour);
 
     if (depth == 0 || moves.empty())
@@ -629,10 +1347,44 @@ double minmax(const Game &current_state, bool &time_up, uint8_t depth, double al
     double value = std::numeric_limits<double>::infinity();
     value *= my_colour ? -1 : 1;
 
+    if (depth == 1)
+    { // last ply: score replies one kernel batch at a time and walk them like depth 0 calls,
+      // so a cut-off still skips the batches after it
+        std::array<Game, EVAL_BATCH> children;
+        std::array<double, EVAL_BATCH> scores;
+        std::array<Square, EVAL_BATCH> to_move;
+        to_move.fill(op_colour(colour));
+
+        for (size_t first = 0; first < moves.size(); first += EVAL_BATCH)
+        {
+            size_t batch = std::min(moves.size() - first, static_cast<size_t>(EVAL_BATCH));
+            for (size_t n = 0; n < batch; n++)
+            {
+                children[n] = perform_move(current_state, moves[first + n], colour);
+            }
+            evaluate_states(children.data(), to_move.data(), batch, scores.data());
+
+            for (size_t n = 0; n < batch; n++)
+            {
+                if (!enter_node(search))
+                    return -1;
+                value = my_colour ? std::max(value, scores[n]) : std::min(value, scores[n]);
+                if ((my_colour && value >= beta) || (!my_colour && value <= alpha))
+                {
+                    return value;
+                }
+                my_colour ? alpha = std::max(alpha, value) : beta = std::min(beta, value);
+            }
+        }
+
+        return value;
+    }
+
     for (Move m : moves)
     {
         auto next_state = perform_move(current_state, m, colour);
-        value = std::max(value, minmax(next_state, time_up, depth - 1, alpha, beta, op_colour(colour)));
+        double child = minmax(next_state, search, depth - 1, alpha, beta, op_colour(colour));
+        value = my_colour ? std::max(value, child) : std::min(value, child);
         if ((my_colour && value >= beta) || (!my_colour && value <= alpha))
         {
             break;
@@ -643,33 +1395,122 @@ double minmax(const Game &current_state, bool &time_up, uint8_t depth, double al
     return value;
 }
 
-void play(const Game &current_state, Move &best_move, bool &time_up)
+bool search_root(const Game &current_state, const std::vector<Move> &moves, int depth, Search &search, Move &iteration_best)
 {
-    auto moves = get_moves(current_state, current_state.my_colour);
+    iteration_best = moves.front();
+    iteration_best.score = -std::numeric_limits<double>::infinity();
 
     for (Move m : moves)
     {
         auto next_state = perform_move(current_state, m, current_state.my_colour);
-        double inf = -std::numeric_limits<double>::infinity();
-        m.score = minmax(next_state, time_up, MAX_DEPTH, -inf, inf, current_state.my_colour);
+        double inf = std::numeric_limits<double>::infinity();
+        m.score = minmax(next_state, search, depth, iteration_best.score, inf, op_colour(current_state.my_colour));
         std::lock_guard<std::mutex> guard(mutex);
-        if (time_up)
+        if (search.time_up)
         {
-            return;
+            return false;
         }
-        best_move = best_move.score < m.score ? m : best_move;
+        iteration_best = iteration_best.score < m.score ? m : iteration_best;
     }
 
-    return;
+    return true;
 }
 
-void print_best_move(int time, bool &time_up, Move &best_move)
+void play(const Game &current_state, Move &best_move, Search &search)
 {
-    std::this_thread::sleep_for(std::chrono::milliseconds(time * 1000 - 750));
+    PROFILE_SEARCH();
+    PROFILE_SCOPE("play");
+    auto moves = get_moves(current_state, current_state.my_colour);
+    int empties = NUM_SQUARES - current_state.black_squares - current_state.white_squares;
+
+    if (!moves.empty())
+    { // never answer with a move that is not legal here, even if no iteration completes
+        std::lock_guard<std::mutex> guard(mutex);
+        best_move = moves.front();
+    }
+
+    std::chrono::steady_clock::duration previous_iteration{0};
+
+    for (int depth = 0; depth <= search.depth && !moves.empty(); depth++)
+    {
+        auto iteration_start = std::chrono::steady_clock::now();
+        Move iteration_best;
+        if (!search_root(current_state, moves, depth, search, iteration_best))
+            break; // unfinished iteration, keep the previous best move
+        auto now = std::chrono::steady_clock::now();
+        auto iteration = now - iteration_start;
+
+        std::lock_guard<std::mutex> guard(mutex);
+        if (depth > 0 && iteration_best.coords != best_move.coords)
+        { // unstable root, think longer
+            search.soft = std::min(search.hard, search.soft * 3 / 2);
+        }
+        best_move = iteration_best;
+        if (depth + 1 >= empties)
+            break; // every line already ends at a full board or a pass leaf, deeper iterations repeat this one
+
+        if (search.limit == Limit::time)
+        { // only start the next iteration if it is expected to finish within the soft limit
+            auto growth = DEFAULT_GROWTH;
+            if (previous_iteration.count() > 0)
+                growth = static_cast<int>(std::clamp<decltype(iteration.count())>(iteration / previous_iteration, MIN_GROWTH, MAX_GROWTH));
+            if (now - search.start + iteration * growth > search.soft)
+                break;
+        }
+        previous_iteration = iteration;
+    }
+
     std::lock_guard<std::mutex> guard(mutex);
-    time_up = true;
-    std::cout << best_move.to_string() << std::endl;
-    return;
+    search.done = true;
+    search_done.notify_all();
+}
+
+void allocate_time(const Game &game, const Clock &clock, Search &search)
+{
+    auto overshoot = std::chrono::ceil<std::chrono::milliseconds>(clock.overshoot);
+    auto margin = std::chrono::milliseconds(MIN_SAFETY_MARGIN_MS) + OVERSHOOT_MARGIN_FACTOR * overshoot;
+    auto available = clock.game_clock ? clock.remaining : std::chrono::milliseconds(game.time * 1000);
+    auto hard = std::max(available - margin, std::chrono::milliseconds(MIN_THINK_MS));
+    int empties = NUM_SQUARES - game.black_squares - game.white_squares;
+
+    if (!clock.game_clock)
+    { // per-move clock: unused time is lost, so every move may use the whole budget
+        search.hard = hard;
+        search.soft = hard;
+        return;
+    }
+
+    auto share = clock.remaining / ((empties + 1) / 2 + MOVES_TO_GO_RESERVE);
+    auto soft = share + clock.increment;
+    if (empties > OPENING_EMPTIES)
+        soft = soft * OPENING_SHARE / 100;
+    else if (empties >= MIDGAME_EMPTIES)
+        soft = soft * MIDGAME_SHARE / 100;
+
+    search.hard = std::min(hard, HARD_SHARES * share + clock.increment);
+    search.soft = std::min(soft, search.hard);
+}
+
+std::chrono::steady_clock::time_point send_move(Move move)
+{
+    std::cout << move.to_string() << std::endl;
+    return std::chrono::steady_clock::now();
+}
+
+std::chrono::steady_clock::time_point print_best_move(Search &search, Move &best_move, Clock &clock)
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    auto deadline = search.start + search.hard;
+    search_done.wait_until(guard, deadline, [&]
+                           { return search.done; });
+    search.time_up = true;
+    auto sent = send_move(best_move);
+    if (sent > deadline)
+    { // wake-up, lock and flush lateness, the margin has to cover it next time
+        auto late = std::chrono::duration_cast<std::chrono::microseconds>(sent - deadline);
+        clock.overshoot = std::max(clock.overshoot, late);
+    }
+    return sent;
 }
 
 void print_state(const Game &game)
@@ -707,55 +1548,208 @@ Move load_move(std::string move)
     return m;
 }
 
-void start_command(std::string input, Game &game)
+void start_command(std::string_view input, Game &game, Clock &clock)
 {
-    game = get_params(input);
+    if (!get_params(input, game, clock))
+        return;
     std::cout << "1" << std::endl;
 }
 
-void move_command(std::string input, Game game)
+void move_command(std::string_view input, Game game, Clock &clock, std::chrono::steady_clock::time_point received)
 {
-    bool time_up = false;
-    Move best_move{};
+    Search search;
+    search.start = received;
+
+    if (!get_state(input, game) || !get_limits(input, search))
+        return;
+    auto moves = get_moves(game, game.my_colour);
+    if (moves.empty())
+    {
+        std::clog << "No legal move." << std::endl;
+        return;
+    }
+    Move best_move = moves.front();
+
+    std::chrono::steady_clock::time_point sent;
+    if (search.limit != Limit::time)
+    { // fixed budget: search on this thread so the result does not depend on timing
+        play(game, best_move, search);
+        sent = send_move(best_move);
+    }
+    else if (std::all_of(moves.begin(), moves.end(), [&](Move m)
+                    { return m.coords == best_move.coords; }))
+    { // forced move, nothing to think about
+        sent = send_move(best_move);
+    }
+    else
+    {
+        search.depth = NUM_SQUARES;
+        allocate_time(game, clock, search);
+        std::thread t{play, std::ref(game), std::ref(best_move), std::ref(search)};
+        sent = print_best_move(search, best_move, clock);
+        if (t.joinable())
+        {
+            t.join();
+        }
+    }
+
+    if (clock.game_clock)
+    { // the opponent's clock runs from the reply, not from when the search thread exits
+        auto used = std::chrono::ceil<std::chrono::milliseconds>(sent - received);
+        clock.remaining = std::max(clock.remaining - used, std::chrono::milliseconds(0)) + clock.increment;
+    }
+}
+
+void bench_command()
+{
+    const std::array<std::pair<const char *, Square>, 6> positions = {
+        std::make_pair("---------------------------OX------XO---------------------------", Square::black),
+        std::make_pair("-------------X------X----OOXO-----XXX-----X--X------------------", Square::white),
+        std::make_pair("-------------X--X---X---OOOXX----OOXX-----X-XX---X--X---X-------", Square::black),
+        std::make_pair("------O------O--X---O---XOOOX---XXXOXX---XXOXXX--XXOX---X-------", Square::black),
+        std::make_pair("------O-----XO--XXX-X---XXXXX---XXXXXX-XOOXOOOXO-XXXOO--X-XO-OX-", Square::white),
+        std::make_pair("---XXXO-----XX--XXX-OOOOXXXXX-O-XXXXXO-XXXXOOXXXXXXXOXXXXOOOOOOO", Square::black)};
+
+    uint64_t total_nodes = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    for (auto position : positions)
+    {
+        Game game;
+        Search search;
+        Move best_move{};
+
+        game.started = true;
+        game.my_colour = position.second;
+        search.limit = Limit::depth;
+        search.depth = BENCH_DEPTH;
+
+        load_board(position.first, game);
+        play(game, best_move, search);
+        total_nodes += search.nodes;
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    uint64_t nps = elapsed.count() > 0 ? total_nodes * 1000000 / elapsed.count() : 0;
+
+    std::cout << "Nodes searched: " << total_nodes << std::endl;
+    std::cout << "NPS: " << nps << std::endl;
+
+    std::vector<Game> leaves;
+    std::vector<Square> to_move;
+    for (auto position : positions)
+    {
+        Game game;
+        game.started = true;
+        game.my_colour = position.second;
+        load_board(position.first, game);
+
+        for (Move m : get_moves(game, game.my_colour))
+        {
+            auto child = perform_move(game, m, game.my_colour);
+            for (Move reply : get_moves(child, op_colour(game.my_colour)))
+            {
+                leaves.push_back(perform_move(child, reply, op_colour(game.my_colour)));
+                to_move.push_back(game.my_colour);
+            }
+        }
+    }
+
+    std::vector<double> scalar_scores(leaves.size());
+    std::vector<double> batched_scores(leaves.size());
 
-    get_state(input, game);
-    if (get_moves(game, game.my_colour).empty())
+    start = std::chrono::steady_clock::now();
+    for (uint8_t round = 0; round < BENCH_EVAL_ROUNDS; round++)
     {
-        exit(1);
+        for (size_t n = 0; n < leaves.size(); n++)
+        {
+            scalar_scores[n] = evaluate_state(leaves[n], get_moves(leaves[n], to_move[n]));
+        }
     }
-    std::thread t{play, std::ref(game), std::ref(best_move), std::ref(time_up)};
-    print_best_move(game.time, time_up, best_move);
-    if (t.joinable())
+    auto scalar_elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+    start = std::chrono::steady_clock::now();
+    for (uint8_t round = 0; round < BENCH_EVAL_ROUNDS; round++)
     {
-        t.join();
+        evaluate_states(leaves.data(), to_move.data(), leaves.size(), batched_scores.data());
     }
+    auto batched_elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+    if (scalar_scores != batched_scores)
+    {
+        std::clog << "Batched evaluation disagrees with evaluate_state." << std::endl;
+        return;
+    }
+
+    // the kernels alone, on packed boards and without the per-board stability term
+    std::vector<Bitboards> boards(leaves.size());
+    std::vector<EvalTerms> scalar_terms(leaves.size());
+    std::vector<EvalTerms> kernel_terms(leaves.size());
+    for (size_t n = 0; n < leaves.size(); n++)
+    {
+        boards[n] = to_bitboards(leaves[n]);
+    }
+
+    start = std::chrono::steady_clock::now();
+    for (uint16_t round = 0; round < BENCH_KERNEL_ROUNDS; round++)
+    {
+        eval_terms_scalar(boards.data(), boards.size(), scalar_terms.data());
+    }
+    auto scalar_kernel_elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+    start = std::chrono::steady_clock::now();
+    for (uint16_t round = 0; round < BENCH_KERNEL_ROUNDS; round++)
+    {
+        eval_kernel(boards.data(), boards.size(), kernel_terms.data());
+    }
+    auto kernel_elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+    if (std::memcmp(scalar_terms.data(), kernel_terms.data(), scalar_terms.size() * sizeof(EvalTerms)) != 0)
+    {
+        std::clog << "Evaluation kernel " << eval_kernel_name << " disagrees with the scalar kernel." << std::endl;
+        return;
+    }
+
+    uint64_t evaluated = static_cast<uint64_t>(leaves.size()) * BENCH_EVAL_ROUNDS;
+    uint64_t kernel_evaluated = static_cast<uint64_t>(leaves.size()) * BENCH_KERNEL_ROUNDS;
+    std::cout << "Eval evaluate_state: " << (scalar_elapsed.count() > 0 ? evaluated * 1000000 / scalar_elapsed.count() : 0) << " pos/s" << std::endl;
+    std::cout << "Eval evaluate_states: " << (batched_elapsed.count() > 0 ? evaluated * 1000000 / batched_elapsed.count() : 0) << " pos/s" << std::endl;
+    std::cout << "Kernel scalar: " << (scalar_kernel_elapsed.count() > 0 ? kernel_evaluated * 1000000 / scalar_kernel_elapsed.count() : 0) << " pos/s" << std::endl;
+    std::cout << "Kernel " << eval_kernel_name << ": " << (kernel_elapsed.count() > 0 ? kernel_evaluated * 1000000 / kernel_elapsed.count() : 0) << " pos/s" << std::endl;
 }
 
 int main()
 {
-    std::string input;
+    LineReader reader;
+    std::string_view input;
     Game game;
+    Clock clock;
 
-    while (std::getline(std::cin, input))
+    while (reader.next_line(input))
     {
+        auto received = std::chrono::steady_clock::now();
 
-        std::string result;
         Command command;
-        command = get_command(input);
-        Move move;
+        if (!get_command(input, command))
+            continue;
 
         switch (command)
         {
         case Command::start:
-            start_command(input, game);
+            start_command(input, game, clock);
             break;
         case Command::move:
-            move_command(input, game);
+            move_command(input, game, clock, received);
+            break;
+        case Command::bench:
+            bench_command();
+            break;
+        case Command::play:
             break;
         case Command::stop:
             return 0;
         }
-
-        return 0;
     }
-}
\ No newline at end of file
+
+    return 0;
+}